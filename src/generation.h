@@ -3,23 +3,22 @@
 #include <string>
 #include <vector>
 #include <memory>
-#include <unordered_map>
-#include <unordered_set>
 #include "parser.h"
 using namespace std;
 
 class Generator {
 public:
-    inline explicit Generator(const Program& prog) : p(prog) {}
+    // unroll caps the copies of a doit body per loop trip (1 disables
+    // unrolling); body size is capped separately by unroll_budget.
+    inline Generator(const Program& prog, const Symbols& syms, int unroll = 4) : p(prog), syms(syms), unroll(unroll) {}
     string generate() {
-        collect();
         o.str(string());
         o.clear();
         o << "section .data\n";
         o << "newline db 10\n";
-        for (size_t i = 0; i < strings.size(); ++i) {
+        for (size_t i = 0; i < syms.strings.size(); ++i) {
             o << "str" << i << " db ";
-            const string& s = strings[i];
+            const string& s = syms.strings.name((int)i);
             bool first = true;
             o << "'";
             for (char c : s) {
@@ -31,7 +30,7 @@ public:
         }
         o << "section .bss\n";
         o << "numbuf resb 64\n";
-        for (size_t i = 0; i < vars.size(); ++i) {
+        for (size_t i = 0; i < syms.idents.size(); ++i) {
             o << "var" << i << " resq 1\n";
         }
         o << "section .text\n";
@@ -44,93 +43,40 @@ public:
         return o.str();
     }
 private:
+    // Pending codegen work: a statement to lower, or (stmt == nullptr) assembly
+    // to emit once everything pushed above it has been lowered.
+    struct Work { const Stmt* stmt; string text; };
+
+    // Most AST nodes an unrolled doit may expand to.
+    static constexpr int unroll_budget = 256;
+
     const Program& p;
+    const Symbols& syms;
+    int unroll;
     stringstream o;
-    unordered_map<string,int> var_index;
-    vector<string> vars;
-    vector<string> strings;
-    unordered_map<string,int> str_index;
     int label_id = 0;
+    vector<Work> work;
+    vector<pair<const Expr*, int>> expr_work;
 
     int new_label() { return ++label_id; }
 
-    void collect_expr(const Expr& e) {
-        switch (e.kind) {
-            case ExprKind::Var:
-                ensure_var(e.var_name);
-                break;
-            case ExprKind::Assign:
-                ensure_var(e.assign.name);
-                collect_expr(*e.assign.value);
-                break;
-            case ExprKind::Unary:
-                collect_expr(*e.unary.operand);
-                break;
-            case ExprKind::Binary:
-                collect_expr(*e.binary.left);
-                collect_expr(*e.binary.right);
-                break;
-            case ExprKind::Grouping:
-                collect_expr(*e.group.inner);
-                break;
-            case ExprKind::Str:
-                ensure_str(e.str_lit);
-                break;
-            default:
-                break;
-        }
-    }
-    void collect_stmt(const Stmt& s) {
-        switch (s.kind) {
-            case StmtKind::VarDecl:
-                ensure_var(s.vardecl.name);
-                collect_expr(*s.vardecl.value);
-                break;
-            case StmtKind::Yeet:
-                collect_expr(*s.exit.expr);
-                break;
-            case StmtKind::ExprStmt:
-                collect_expr(*s.exprstmt.expr);
-                break;
-            case StmtKind::If:
-                collect_expr(*s.ifs.cond);
-                for (auto& t : s.ifs.then_stmts) collect_stmt(*t);
-                for (auto& e : s.ifs.else_stmts) collect_stmt(*e);
-                break;
-            case StmtKind::LoopDoIt:
-                collect_expr(*s.loop.count);
-                for (auto& b : s.loop.body) collect_stmt(*b);
-                break;
-            case StmtKind::Print:
-                collect_expr(*s.print.expr);
-                break;
-            case StmtKind::Block:
-                for (auto& b : s.block.stmts) collect_stmt(*b);
-                break;
-        }
-    }
-    void collect() {
-        for (auto& s : p.body) collect_stmt(*s);
-    }
-    void ensure_var(const string& name) {
-        if (!var_index.count(name)) {
-            int idx = (int)vars.size();
-            var_index[name] = idx;
-            vars.push_back(name);
-        }
-    }
-    void ensure_str(const string& s) {
-        if (!str_index.count(s)) {
-            int idx = (int)strings.size();
-            str_index[s] = idx;
-            strings.push_back(s);
+    void gen_block(const vector<unique_ptr<Stmt>>& stmts) {
+        size_t base = work.size();
+        push_block(stmts);
+        while (work.size() > base) {
+            Work w = move(work.back());
+            work.pop_back();
+            if (w.stmt) gen_stmt(*w.stmt);
+            else o << w.text;
         }
     }
-
-    void gen_block(const vector<unique_ptr<Stmt>>& stmts) {
-        for (auto& s : stmts) gen_stmt(*s);
+    void push_block(const vector<unique_ptr<Stmt>>& stmts) {
+        for (auto it = stmts.rbegin(); it != stmts.rend(); ++it) work.push_back(Work{it->get(), {}});
     }
+    void push_text(string text) { work.push_back(Work{nullptr, move(text)}); }
 
+    // Emits the statement's own code and queues its nested bodies on `work`
+    // (in reverse, since it is a stack) instead of recursing into them.
     void gen_stmt(const Stmt& s) {
         switch (s.kind) {
             case StmtKind::Yeet: {
@@ -145,7 +91,7 @@ private:
                 break;
             }
             case StmtKind::Block: {
-                gen_block(s.block.stmts);
+                push_block(s.block.stmts);
                 break;
             }
             case StmtKind::If: {
@@ -154,14 +100,14 @@ private:
                 gen_expr(*s.ifs.cond);
                 o << "    cmp rax, 0\n";
                 o << "    je .L" << L_else << "\n";
-                gen_block(s.ifs.then_stmts);
-                o << "    jmp .L" << L_end << "\n";
-                o << ".L" << L_else << ":\n";
-                gen_block(s.ifs.else_stmts);
-                o << ".L" << L_end << ":\n";
+                push_text(".L" + to_string(L_end) + ":\n");
+                push_block(s.ifs.else_stmts);
+                push_text("    jmp .L" + to_string(L_end) + "\n.L" + to_string(L_else) + ":\n");
+                push_block(s.ifs.then_stmts);
                 break;
             }
             case StmtKind::LoopDoIt: {
+                if (gen_unrolled_loop(s)) break;
                 int L_top = new_label();
                 int L_end = new_label();
                 gen_expr(*s.loop.count);
@@ -169,15 +115,13 @@ private:
                 o << "    cmp r10, 0\n";
                 o << "    jle .L" << L_end << "\n";
                 o << ".L" << L_top << ":\n";
-                gen_block(s.loop.body);
-                o << "    dec r10\n";
-                o << "    jnz .L" << L_top << "\n";
-                o << ".L" << L_end << ":\n";
+                push_text("    dec r10\n    jnz .L" + to_string(L_top) + "\n.L" + to_string(L_end) + ":\n");
+                push_block(s.loop.body);
                 break;
             }
             case StmtKind::VarDecl: {
                 gen_expr(*s.vardecl.value);
-                int idx = var_index[s.vardecl.name];
+                int idx = s.vardecl.sym;
                 o << "    mov [var" << idx << "], rax\n";
                 break;
             }
@@ -188,9 +132,89 @@ private:
         }
     }
 
+    // Lowers a doit whose body holds no nested loop (those share r10), either
+    // fully unrolled when the count is a literal and every copy fits the
+    // budget, or unrolled by a power of two k with the leftover count % k
+    // trips peeled (literal count) or run by a remainder loop first.
+    bool gen_unrolled_loop(const Stmt& s) {
+        int cost = body_cost(s.loop.body);
+        if (unroll <= 1 || cost < 0) return false;
+        const Expr* cnt = s.loop.count.get();
+        while (cnt->kind == ExprKind::Grouping) cnt = cnt->group.inner.get();
+        if (cnt->kind == ExprKind::Int && (cost == 0 || cnt->int_lit <= unroll_budget / cost)) {
+            if (cost > 0) for (long long n = 0; n < cnt->int_lit; ++n) push_block(s.loop.body);
+            return true;
+        }
+        int k = 1;
+        while (k < unroll_budget && k * 2 <= unroll && cost * k * 2 <= unroll_budget) k *= 2;
+        if (k == 1) return false;
+        if (cnt->kind == ExprKind::Int) {
+            long long rem = cnt->int_lit % k;
+            int L_top = new_label();
+            push_text("    sub r10, " + to_string(k) + "\n    jnz .L" + to_string(L_top) + "\n");
+            for (int n = 0; n < k; ++n) push_block(s.loop.body);
+            push_text("    mov r10, " + to_string(cnt->int_lit - rem) + "\n.L" + to_string(L_top) + ":\n");
+            for (long long n = 0; n < rem; ++n) push_block(s.loop.body);
+            return true;
+        }
+        int L_rem = new_label();
+        int L_top = new_label();
+        int L_end = new_label();
+        gen_expr(*s.loop.count);
+        o << "    mov r10, rax\n";
+        o << "    cmp r10, 0\n";
+        o << "    jle .L" << L_end << "\n";
+        o << "    test r10, " << k - 1 << "\n";
+        o << "    jz .L" << L_top << "\n";
+        o << ".L" << L_rem << ":\n";
+        push_text("    sub r10, " + to_string(k) + "\n    jnz .L" + to_string(L_top) + "\n.L" + to_string(L_end) + ":\n");
+        for (int n = 0; n < k; ++n) push_block(s.loop.body);
+        push_text("    dec r10\n    test r10, " + to_string(k - 1) + "\n    jnz .L" + to_string(L_rem) + "\n"
+                  "    test r10, r10\n    jz .L" + to_string(L_end) + "\n.L" + to_string(L_top) + ":\n");
+        push_block(s.loop.body);
+        return true;
+    }
+
+    // Number of statement and expression nodes in a loop body, or -1 if it
+    // contains a nested doit.
+    int body_cost(const vector<unique_ptr<Stmt>>& body) {
+        int cost = 0;
+        vector<const Stmt*> stmts;
+        vector<const Expr*> exprs;
+        for (auto& b : body) stmts.push_back(b.get());
+        while (!stmts.empty()) {
+            const Stmt* st = stmts.back();
+            stmts.pop_back();
+            cost++;
+            switch (st->kind) {
+                case StmtKind::LoopDoIt: return -1;
+                case StmtKind::Yeet: exprs.push_back(st->exit.expr.get()); break;
+                case StmtKind::ExprStmt: exprs.push_back(st->exprstmt.expr.get()); break;
+                case StmtKind::VarDecl: exprs.push_back(st->vardecl.value.get()); break;
+                case StmtKind::Print: exprs.push_back(st->print.expr.get()); break;
+                case StmtKind::Block:
+                    for (auto& b : st->block.stmts) stmts.push_back(b.get());
+                    break;
+                case StmtKind::If:
+                    exprs.push_back(st->ifs.cond.get());
+                    for (auto& b : st->ifs.then_stmts) stmts.push_back(b.get());
+                    for (auto& b : st->ifs.else_stmts) stmts.push_back(b.get());
+                    break;
+            }
+        }
+        while (!exprs.empty()) {
+            const Expr* e = exprs.back();
+            exprs.pop_back();
+            cost++;
+            for (const Expr* c : {e->unary.operand.get(), e->binary.left.get(), e->binary.right.get(), e->group.inner.get(), e->assign.value.get()})
+                if (c) exprs.push_back(c);
+        }
+        return cost;
+    }
+
     void gen_print(const Expr& e) {
         if (e.kind == ExprKind::Str) {
-            int si = str_index[e.str_lit];
+            int si = e.str_sym;
             o << "    mov rax, 1\n";
             o << "    mov rdi, 1\n";
             o << "    mov rsi, str" << si << "\n";
@@ -240,106 +264,136 @@ private:
         }
     }
 
-    void gen_expr(const Expr& e) {
-        switch (e.kind) {
-            case ExprKind::Int: {
-                o << "    mov rax, " << e.int_lit << "\n";
-                break;
-            }
-            case ExprKind::Str: {
-                int si = str_index[e.str_lit];
-                o << "    lea rax, [rel str" << si << "]\n";
-                break;
-            }
-            case ExprKind::Var: {
-                int idx = var_index[e.var_name];
-                o << "    mov rax, [var" << idx << "]\n";
-                break;
-            }
-            case ExprKind::Assign: {
-                gen_expr(*e.assign.value);
-                {
-                    int idx = var_index[e.assign.name];
-                    o << "    mov [var" << idx << "], rax\n";
+    // Post-order walk over an explicit stack; the int counts how many of the
+    // node's operands have already been emitted.
+    void gen_expr(const Expr& root) {
+        expr_work.push_back({&root, 0});
+        while (!expr_work.empty()) {
+            auto [e, stage] = expr_work.back();
+            switch (e->kind) {
+                case ExprKind::Int: {
+                    o << "    mov rax, " << e->int_lit << "\n";
+                    expr_work.pop_back();
+                    break;
                 }
-                break;
-            }
-            case ExprKind::Unary: {
-                gen_expr(*e.unary.operand);
-                if (e.unary.op == TokenType::Minus) {
-                    o << "    neg rax\n";
+                case ExprKind::Str: {
+                    int si = e->str_sym;
+                    o << "    lea rax, [rel str" << si << "]\n";
+                    expr_work.pop_back();
+                    break;
                 }
-                break;
-            }
-            case ExprKind::Binary: {
-                gen_expr(*e.binary.left);
-                o << "    push rax\n";
-                gen_expr(*e.binary.right);
-                o << "    mov rbx, rax\n";
-                o << "    pop rcx\n";
-                switch (e.binary.op) {
-                    case TokenType::Plus:
-                        o << "    add rcx, rbx\n";
-                        o << "    mov rax, rcx\n";
-                        break;
-                    case TokenType::Minus:
-                        o << "    sub rcx, rbx\n";
-                        o << "    mov rax, rcx\n";
-                        break;
-                    case TokenType::Star:
-                        o << "    mov rax, rcx\n";
-                        o << "    imul rax, rbx\n";
-                        break;
-                    case TokenType::Slash:
-                        o << "    mov rax, rcx\n";
-                        o << "    cqo\n";
-                        o << "    idiv rbx\n";
-                        break;
-                    case TokenType::Percent:
-                        o << "    mov rax, rcx\n";
-                        o << "    cqo\n";
-                        o << "    idiv rbx\n";
-                        o << "    mov rax, rdx\n";
-                        break;
-                    case TokenType::EqualEqual:
-                        o << "    cmp rcx, rbx\n";
-                        o << "    mov rax, 0\n";
-                        o << "    sete al\n";
-                        break;
-                    case TokenType::BangEqual:
-                        o << "    cmp rcx, rbx\n";
-                        o << "    mov rax, 0\n";
-                        o << "    setne al\n";
-                        break;
-                    case TokenType::Less:
-                        o << "    cmp rcx, rbx\n";
-                        o << "    mov rax, 0\n";
-                        o << "    setl al\n";
-                        break;
-                    case TokenType::LessEqual:
-                        o << "    cmp rcx, rbx\n";
-                        o << "    mov rax, 0\n";
-                        o << "    setle al\n";
+                case ExprKind::Var: {
+                    int idx = e->var_sym;
+                    o << "    mov rax, [var" << idx << "]\n";
+                    expr_work.pop_back();
+                    break;
+                }
+                case ExprKind::Assign: {
+                    if (stage == 0) {
+                        expr_work.back().second = 1;
+                        expr_work.push_back({e->assign.value.get(), 0});
                         break;
-                    case TokenType::Greater:
-                        o << "    cmp rcx, rbx\n";
-                        o << "    mov rax, 0\n";
-                        o << "    setg al\n";
+                    }
+                    int idx = e->assign.sym;
+                    o << "    mov [var" << idx << "], rax\n";
+                    expr_work.pop_back();
+                    break;
+                }
+                case ExprKind::Unary: {
+                    if (stage == 0) {
+                        expr_work.back().second = 1;
+                        expr_work.push_back({e->unary.operand.get(), 0});
                         break;
-                    case TokenType::GreaterEqual:
-                        o << "    cmp rcx, rbx\n";
-                        o << "    mov rax, 0\n";
-                        o << "    setge al\n";
+                    }
+                    if (e->unary.op == TokenType::Minus) {
+                        o << "    neg rax\n";
+                    }
+                    expr_work.pop_back();
+                    break;
+                }
+                case ExprKind::Binary: {
+                    if (stage == 0) {
+                        expr_work.back().second = 1;
+                        expr_work.push_back({e->binary.left.get(), 0});
                         break;
-                    default:
+                    }
+                    if (stage == 1) {
+                        o << "    push rax\n";
+                        expr_work.back().second = 2;
+                        expr_work.push_back({e->binary.right.get(), 0});
                         break;
+                    }
+                    o << "    mov rbx, rax\n";
+                    o << "    pop rcx\n";
+                    gen_binop(e->binary.op);
+                    expr_work.pop_back();
+                    break;
+                }
+                case ExprKind::Grouping: {
+                    expr_work.back().first = e->group.inner.get();
+                    break;
                 }
-                break;
             }
-            case ExprKind::Grouping: {
-                gen_expr(*e.group.inner);
+        }
+    }
+
+    void gen_binop(TokenType op) {
+        switch (op) {
+            case TokenType::Plus:
+                o << "    add rcx, rbx\n";
+                o << "    mov rax, rcx\n";
+                break;
+            case TokenType::Minus:
+                o << "    sub rcx, rbx\n";
+                o << "    mov rax, rcx\n";
+                break;
+            case TokenType::Star:
+                o << "    mov rax, rcx\n";
+                o << "    imul rax, rbx\n";
+                break;
+            case TokenType::Slash:
+                o << "    mov rax, rcx\n";
+                o << "    cqo\n";
+                o << "    idiv rbx\n";
+                break;
+            case TokenType::Percent:
+                o << "    mov rax, rcx\n";
+                o << "    cqo\n";
+                o << "    idiv rbx\n";
+                o << "    mov rax, rdx\n";
+                break;
+            case TokenType::EqualEqual:
+                o << "    cmp rcx, rbx\n";
+                o << "    mov rax, 0\n";
+                o << "    sete al\n";
+                break;
+            case TokenType::BangEqual:
+                o << "    cmp rcx, rbx\n";
+                o << "    mov rax, 0\n";
+                o << "    setne al\n";
+                break;
+            case TokenType::Less:
+                o << "    cmp rcx, rbx\n";
+                o << "    mov rax, 0\n";
+                o << "    setl al\n";
+                break;
+            case TokenType::LessEqual:
+                o << "    cmp rcx, rbx\n";
+                o << "    mov rax, 0\n";
+                o << "    setle al\n";
+                break;
+            case TokenType::Greater:
+                o << "    cmp rcx, rbx\n";
+                o << "    mov rax, 0\n";
+                o << "    setg al\n";
+                break;
+            case TokenType::GreaterEqual:
+                o << "    cmp rcx, rbx\n";
+                o << "    mov rax, 0\n";
+                o << "    setge al\n";
+                break;
+            default:
                 break;
-            }
         }
     }
 };
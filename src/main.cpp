@@ -9,13 +9,32 @@
 using namespace std;
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        cerr << "usage: bl <input.bl>\n";
+    int unroll = 4;
+    const char* path = nullptr;
+    for (int a = 1; a < argc; ++a) {
+        string arg = argv[a];
+        if (arg.rfind("--unroll=", 0) == 0) {
+            char* end = nullptr;
+            long v = strtol(arg.c_str() + 9, &end, 10);
+            if (*end != '\0' || end == arg.c_str() + 9 || v < 1 || v > 1024) {
+                cerr << "bad --unroll value\n";
+                return EXIT_FAILURE;
+            }
+            unroll = (int)v;
+        } else if (!path) {
+            path = argv[a];
+        } else {
+            path = nullptr;
+            break;
+        }
+    }
+    if (!path) {
+        cerr << "usage: bl [--unroll=N] <input.bl>\n";
         return EXIT_FAILURE;
     }
     string contents;
     {
-        ifstream in(argv[1], ios::in | ios::binary);
+        ifstream in(path, ios::in | ios::binary);
         if (!in) {
             cerr << "cannot open input\n";
             return EXIT_FAILURE;
@@ -24,9 +43,10 @@ int main(int argc, char* argv[]) {
         ss << in.rdbuf();
         contents = ss.str();
     }
+    Symbols syms;
     vector<Token> toks;
     try {
-        Tokenizer tz(contents);
+        Tokenizer tz(contents, syms);
         toks = tz.tokenize();
     } catch (const exception& e) {
         cerr << "tokenize error\n";
@@ -38,7 +58,7 @@ int main(int argc, char* argv[]) {
         cerr << "parse error\n";
         return EXIT_FAILURE;
     }
-    Generator gen(prog.value());
+    Generator gen(prog.value(), syms, unroll);
     {
         ofstream out("out.asm", ios::out | ios::trunc);
         out << gen.generate();
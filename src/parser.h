@@ -3,7 +3,6 @@
 #include <string>
 #include <optional>
 #include <memory>
-#include <unordered_map>
 #include "tokenization.h"
 using namespace std;
 
@@ -13,12 +12,31 @@ enum class StmtKind { Yeet, ExprStmt, Block, If, LoopDoIt, VarDecl, Print };
 struct Expr {
     ExprKind kind;
     long long int_lit;
-    string str_lit;
-    string var_name;
+    int str_sym;
+    int var_sym;
     struct { TokenType op; unique_ptr<Expr> operand; } unary;
     struct { TokenType op; unique_ptr<Expr> left; unique_ptr<Expr> right; } binary;
     struct { unique_ptr<Expr> inner; } group;
-    struct { string name; unique_ptr<Expr> value; } assign;
+    struct { int sym; unique_ptr<Expr> value; } assign;
+
+    // Children are detached onto a heap stack before they die, so tearing
+    // down an arbitrarily deep tree never recurses.
+    ~Expr() {
+        vector<unique_ptr<Expr>> dead;
+        release_children(dead);
+        while (!dead.empty()) {
+            unique_ptr<Expr> e = move(dead.back());
+            dead.pop_back();
+            e->release_children(dead);
+        }
+    }
+    void release_children(vector<unique_ptr<Expr>>& out) {
+        if (unary.operand) out.push_back(move(unary.operand));
+        if (binary.left) out.push_back(move(binary.left));
+        if (binary.right) out.push_back(move(binary.right));
+        if (group.inner) out.push_back(move(group.inner));
+        if (assign.value) out.push_back(move(assign.value));
+    }
 };
 
 struct Stmt {
@@ -28,8 +46,24 @@ struct Stmt {
     struct { vector<unique_ptr<Stmt>> stmts; } block;
     struct { unique_ptr<Expr> cond; vector<unique_ptr<Stmt>> then_stmts; vector<unique_ptr<Stmt>> else_stmts; } ifs;
     struct { unique_ptr<Expr> count; vector<unique_ptr<Stmt>> body; } loop;
-    struct { string name; unique_ptr<Expr> value; } vardecl;
+    struct { int sym; unique_ptr<Expr> value; } vardecl;
     struct { unique_ptr<Expr> expr; } print;
+
+    ~Stmt() {
+        vector<unique_ptr<Stmt>> dead;
+        release_children(dead);
+        while (!dead.empty()) {
+            unique_ptr<Stmt> s = move(dead.back());
+            dead.pop_back();
+            s->release_children(dead);
+        }
+    }
+    void release_children(vector<unique_ptr<Stmt>>& out) {
+        for (auto* list : {&block.stmts, &ifs.then_stmts, &ifs.else_stmts, &loop.body}) {
+            for (auto& s : *list) out.push_back(move(s));
+            list->clear();
+        }
+    }
 };
 
 struct Program { vector<unique_ptr<Stmt>> body; };
@@ -39,14 +73,40 @@ public:
     inline explicit Parser(vector<Token> t) : toks(move(t)) {}
     optional<Program> parse() {
         Program prog;
-        while (!is_at_end()) {
-            auto s = parse_stmt();
-            if (!s) return {};
-            prog.body.push_back(move(*s));
+        vector<Frame> open;
+        open.push_back(Frame{nullptr, &prog.body});
+        while (true) {
+            Frame& top = open.back();
+            if (open.size() == 1) {
+                if (is_at_end()) break;
+            } else if (consume(TokenType::RBrace)) {
+                if (top.stmt->kind == StmtKind::If && top.into == &top.stmt->ifs.then_stmts) {
+                    if (!match({TokenType::Else})) return {};
+                    if (!consume(TokenType::LBrace)) return {};
+                    top.into = &top.stmt->ifs.else_stmts;
+                    continue;
+                }
+                auto done = move(top.stmt);
+                open.pop_back();
+                open.back().into->push_back(move(done));
+                continue;
+            } else if (is_at_end()) {
+                return {};
+            }
+            if (!parse_stmt(open)) return {};
         }
         return prog;
     }
 private:
+    // A brace-delimited body still being filled: the statement that owns it
+    // (null for the program itself) and the list its children go into.
+    struct Frame { unique_ptr<Stmt> stmt; vector<unique_ptr<Stmt>>* into; };
+
+    // An operator still waiting for its right-hand side. Group marks an
+    // open '(' and is never folded by reduce().
+    enum class OpKind { Unary, Binary, Assign, Group };
+    struct PendingOp { OpKind kind; TokenType op; int prec; int sym; };
+
     vector<Token> toks;
     size_t i = 0;
 
@@ -58,171 +118,178 @@ private:
     bool match(initializer_list<TokenType> ts) { for (auto t: ts) if (check(t)) { advance(); return true; } return false; }
     bool consume(TokenType t) { if (check(t)) { advance(); return true; } return false; }
 
-    optional<unique_ptr<Stmt>> parse_stmt() {
+    // Parses one statement into the innermost open body. Statements that
+    // open a brace push a new frame instead; parse() closes it later.
+    bool parse_stmt(vector<Frame>& open) {
+        auto& into = *open.back().into;
         if (match({TokenType::Yeet})) {
             auto e = parse_expr();
-            if (!e) return {};
-            if (!consume(TokenType::Semicolon)) return {};
+            if (!e) return false;
+            if (!consume(TokenType::Semicolon)) return false;
             auto s = make_unique<Stmt>();
             s->kind = StmtKind::Yeet;
             s->exit.expr = move(*e);
-            return s;
+            into.push_back(move(s));
+            return true;
         }
         if (match({TokenType::Is})) {
-            if (!consume(TokenType::LParen)) return {};
+            if (!consume(TokenType::LParen)) return false;
             auto cond = parse_expr();
-            if (!cond) return {};
-            if (!consume(TokenType::RParen)) return {};
-            auto thenb = parse_block();
-            if (!thenb) return {};
-            if (!match({TokenType::Else})) return {};
-            auto elseb = parse_block();
-            if (!elseb) return {};
+            if (!cond) return false;
+            if (!consume(TokenType::RParen)) return false;
+            if (!consume(TokenType::LBrace)) return false;
             auto s = make_unique<Stmt>();
             s->kind = StmtKind::If;
             s->ifs.cond = move(*cond);
-            s->ifs.then_stmts = move((*thenb)->block.stmts);
-            s->ifs.else_stmts = move((*elseb)->block.stmts);
-            return s;
+            auto* body = &s->ifs.then_stmts;
+            open.push_back(Frame{move(s), body});
+            return true;
         }
         if (match({TokenType::DoIt})) {
-            if (!consume(TokenType::LParen)) return {};
+            if (!consume(TokenType::LParen)) return false;
             auto cnt = parse_expr();
-            if (!cnt) return {};
-            if (!consume(TokenType::RParen)) return {};
-            auto body = parse_block();
-            if (!body) return {};
+            if (!cnt) return false;
+            if (!consume(TokenType::RParen)) return false;
+            if (!consume(TokenType::LBrace)) return false;
             auto s = make_unique<Stmt>();
             s->kind = StmtKind::LoopDoIt;
             s->loop.count = move(*cnt);
-            s->loop.body = move((*body)->block.stmts);
-            return s;
+            auto* body = &s->loop.body;
+            open.push_back(Frame{move(s), body});
+            return true;
         }
         if (match({TokenType::Imagine})) {
-            if (!check(TokenType::Identifier)) return {};
-            string name = peek().lexeme.value();
+            if (!check(TokenType::Identifier)) return false;
+            int sym = peek().sym;
             advance();
-            if (!consume(TokenType::Assign)) return {};
+            if (!consume(TokenType::Assign)) return false;
             auto val = parse_expr();
-            if (!val) return {};
-            if (!consume(TokenType::Semicolon)) return {};
+            if (!val) return false;
+            if (!consume(TokenType::Semicolon)) return false;
             auto s = make_unique<Stmt>();
             s->kind = StmtKind::VarDecl;
-            s->vardecl.name = name;
+            s->vardecl.sym = sym;
             s->vardecl.value = move(*val);
-            return s;
+            into.push_back(move(s));
+            return true;
         }
         if (match({TokenType::Print})) {
-            if (!consume(TokenType::LParen)) return {};
+            if (!consume(TokenType::LParen)) return false;
             auto e = parse_expr();
-            if (!e) return {};
-            if (!consume(TokenType::RParen)) return {};
-            if (!consume(TokenType::Semicolon)) return {};
+            if (!e) return false;
+            if (!consume(TokenType::RParen)) return false;
+            if (!consume(TokenType::Semicolon)) return false;
             auto s = make_unique<Stmt>();
             s->kind = StmtKind::Print;
             s->print.expr = move(*e);
-            return s;
+            into.push_back(move(s));
+            return true;
         }
-        if (check(TokenType::LBrace)) {
-            return parse_block();
+        if (consume(TokenType::LBrace)) {
+            auto s = make_unique<Stmt>();
+            s->kind = StmtKind::Block;
+            auto* body = &s->block.stmts;
+            open.push_back(Frame{move(s), body});
+            return true;
         }
         auto e = parse_expr();
-        if (!e) return {};
-        if (!consume(TokenType::Semicolon)) return {};
+        if (!e) return false;
+        if (!consume(TokenType::Semicolon)) return false;
         auto s = make_unique<Stmt>();
         s->kind = StmtKind::ExprStmt;
         s->exprstmt.expr = move(*e);
-        return s;
+        into.push_back(move(s));
+        return true;
     }
 
-    optional<unique_ptr<Stmt>> parse_block() {
-        if (!consume(TokenType::LBrace)) return {};
-        vector<unique_ptr<Stmt>> stmts;
-        while (!check(TokenType::RBrace) && !is_at_end()) {
-            auto s = parse_stmt();
-            if (!s) return {};
-            stmts.push_back(move(*s));
+    static int binary_prec(TokenType t) {
+        switch (t) {
+            case TokenType::EqualEqual: case TokenType::BangEqual:
+                return 1;
+            case TokenType::Less: case TokenType::LessEqual: case TokenType::Greater: case TokenType::GreaterEqual:
+                return 2;
+            case TokenType::Plus: case TokenType::Minus:
+                return 3;
+            case TokenType::Star: case TokenType::Slash: case TokenType::Percent:
+                return 4;
+            default:
+                return 0;
         }
-        if (!consume(TokenType::RBrace)) return {};
-        auto blk = make_unique<Stmt>();
-        blk->kind = StmtKind::Block;
-        blk->block.stmts = move(stmts);
-        return blk;
     }
 
-    optional<unique_ptr<Expr>> parse_expr() { return parse_assignment(); }
-    optional<unique_ptr<Expr>> parse_assignment() {
-        auto left = parse_equality();
-        if (!left) return {};
-        if (match({TokenType::Assign})) {
-            if (left.value()->kind != ExprKind::Var) return {};
-            string name = left.value()->var_name;
-            auto value = parse_assignment();
-            if (!value) return {};
-            auto e = make_unique<Expr>();
-            e->kind = ExprKind::Assign;
-            e->assign.name = name;
-            e->assign.value = move(*value);
-            return e;
-        }
-        return left;
-    }
-    optional<unique_ptr<Expr>> parse_equality() {
-        auto left = parse_relational();
-        if (!left) return {};
-        while (match({TokenType::EqualEqual, TokenType::BangEqual})) {
-            TokenType op = prev().type;
-            auto right = parse_relational();
-            if (!right) return {};
-            left = make_bin(move(*left), op, move(*right));
-        }
-        return left;
-    }
-    optional<unique_ptr<Expr>> parse_relational() {
-        auto left = parse_additive();
-        if (!left) return {};
-        while (match({TokenType::Less, TokenType::LessEqual, TokenType::Greater, TokenType::GreaterEqual})) {
-            TokenType op = prev().type;
-            auto right = parse_additive();
-            if (!right) return {};
-            left = make_bin(move(*left), op, move(*right));
-        }
-        return left;
-    }
-    optional<unique_ptr<Expr>> parse_additive() {
-        auto left = parse_multiplicative();
-        if (!left) return {};
-        while (match({TokenType::Plus, TokenType::Minus})) {
-            TokenType op = prev().type;
-            auto right = parse_multiplicative();
-            if (!right) return {};
-            left = make_bin(move(*left), op, move(*right));
-        }
-        return left;
-    }
-    optional<unique_ptr<Expr>> parse_multiplicative() {
-        auto left = parse_unary();
-        if (!left) return {};
-        while (match({TokenType::Star, TokenType::Slash, TokenType::Percent})) {
-            TokenType op = prev().type;
-            auto right = parse_unary();
-            if (!right) return {};
-            left = make_bin(move(*left), op, move(*right));
+    // Precedence climbing over explicit operand/operator stacks. Unary minus
+    // binds tightest (prec 5), assignment loosest (prec 0, right-assoc, and
+    // only onto a bare variable). An unmatched ')' ends the expression so the
+    // caller can consume it.
+    optional<unique_ptr<Expr>> parse_expr() {
+        vector<unique_ptr<Expr>> vals;
+        vector<PendingOp> ops;
+        size_t depth = 0;
+        while (true) {
+            if (match({TokenType::Minus})) {
+                ops.push_back(PendingOp{OpKind::Unary, TokenType::Minus, 5, -1});
+                continue;
+            }
+            if (match({TokenType::LParen})) {
+                ops.push_back(PendingOp{OpKind::Group, TokenType::LParen, 0, -1});
+                depth++;
+                continue;
+            }
+            auto operand = parse_primary();
+            if (!operand) return {};
+            vals.push_back(move(*operand));
+            while (depth > 0 && consume(TokenType::RParen)) {
+                reduce(vals, ops, 0);
+                ops.pop_back();
+                depth--;
+                auto e = make_unique<Expr>();
+                e->kind = ExprKind::Grouping;
+                e->group.inner = move(vals.back());
+                vals.back() = move(e);
+            }
+            if (int prec = binary_prec(peek().type)) {
+                reduce(vals, ops, prec);
+                ops.push_back(PendingOp{OpKind::Binary, advance().type, prec, -1});
+                continue;
+            }
+            if (match({TokenType::Assign})) {
+                reduce(vals, ops, 1);
+                if (vals.back()->kind != ExprKind::Var) return {};
+                int sym = vals.back()->var_sym;
+                vals.pop_back();
+                ops.push_back(PendingOp{OpKind::Assign, TokenType::Assign, 0, sym});
+                continue;
+            }
+            break;
         }
-        return left;
+        if (depth > 0) return {};
+        reduce(vals, ops, 0);
+        return move(vals.back());
     }
-    optional<unique_ptr<Expr>> parse_unary() {
-        if (match({TokenType::Minus})) {
-            TokenType op = prev().type;
-            auto operand = parse_unary();
-            if (!operand) return {};
+    // Folds pending operators of at least min_prec into vals, stopping at
+    // the innermost open group.
+    void reduce(vector<unique_ptr<Expr>>& vals, vector<PendingOp>& ops, int min_prec) {
+        while (!ops.empty() && ops.back().kind != OpKind::Group && ops.back().prec >= min_prec) {
+            PendingOp op = ops.back();
+            ops.pop_back();
+            if (op.kind == OpKind::Binary) {
+                auto r = move(vals.back());
+                vals.pop_back();
+                vals.back() = make_bin(move(vals.back()), op.op, move(r));
+                continue;
+            }
             auto e = make_unique<Expr>();
-            e->kind = ExprKind::Unary;
-            e->unary.op = op;
-            e->unary.operand = move(*operand);
-            return e;
+            if (op.kind == OpKind::Unary) {
+                e->kind = ExprKind::Unary;
+                e->unary.op = op.op;
+                e->unary.operand = move(vals.back());
+            } else {
+                e->kind = ExprKind::Assign;
+                e->assign.sym = op.sym;
+                e->assign.value = move(vals.back());
+            }
+            vals.back() = move(e);
         }
-        return parse_primary();
     }
     optional<unique_ptr<Expr>> parse_primary() {
         if (match({TokenType::Int})) {
@@ -234,22 +301,13 @@ private:
         if (match({TokenType::String})) {
             auto e = make_unique<Expr>();
             e->kind = ExprKind::Str;
-            e->str_lit = prev().lexeme.value();
+            e->str_sym = prev().sym;
             return e;
         }
         if (match({TokenType::Identifier})) {
             auto e = make_unique<Expr>();
             e->kind = ExprKind::Var;
-            e->var_name = prev().lexeme.value();
-            return e;
-        }
-        if (match({TokenType::LParen})) {
-            auto inner = parse_expr();
-            if (!inner) return {};
-            if (!consume(TokenType::RParen)) return {};
-            auto e = make_unique<Expr>();
-            e->kind = ExprKind::Grouping;
-            e->group.inner = move(*inner);
+            e->var_sym = prev().sym;
             return e;
         }
         return {};
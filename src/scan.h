@@ -0,0 +1,133 @@
+#pragma once
+#include <cstddef>
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define BL_SCAN_X86 1
+#endif
+using namespace std;
+
+// Run-length scanners for the tokenizer: each returns how many leading bytes
+// of [p, p+n) belong to a byte class. The SIMD variants test 16 or 32 bytes
+// per step and finish the tail with the scalar loop.
+namespace scan {
+
+enum class Cls { Space, Ident, Digit, NotQuote };
+
+// Matches isspace/isalnum/isdigit in the C locale; bytes >= 0x80 are never
+// space, identifier or digit bytes.
+inline bool in_class(Cls c, unsigned char ch) {
+    switch (c) {
+        case Cls::Space: return ch == ' ' || (unsigned)(ch - '\t') < 5;
+        case Cls::Ident: return (unsigned)((ch | 0x20) - 'a') < 26 || (unsigned)(ch - '0') < 10 || ch == '_';
+        case Cls::Digit: return (unsigned)(ch - '0') < 10;
+        case Cls::NotQuote: return ch != '"';
+    }
+    return false;
+}
+
+template<Cls C>
+size_t run_scalar(const char* p, size_t n) {
+    size_t i = 0;
+    while (i < n && in_class(C, (unsigned char)p[i])) i++;
+    return i;
+}
+
+#if BL_SCAN_X86
+// Signed byte compares: anything >= 0x80 is negative and falls outside every
+// range tested here.
+__attribute__((target("sse2"))) inline __m128i sse2_between(__m128i v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((char)(lo - 1))), _mm_cmpgt_epi8(_mm_set1_epi8((char)(hi + 1)), v));
+}
+
+template<Cls C>
+__attribute__((target("sse2"))) unsigned sse2_mask(__m128i v) {
+    __m128i m;
+    switch (C) {
+        case Cls::Space:
+            m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), sse2_between(v, '\t', '\r'));
+            break;
+        case Cls::Ident:
+            m = _mm_or_si128(sse2_between(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z'),
+                             _mm_or_si128(sse2_between(v, '0', '9'), _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))));
+            break;
+        case Cls::Digit:
+            m = sse2_between(v, '0', '9');
+            break;
+        case Cls::NotQuote:
+            return ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) & 0xFFFF;
+    }
+    return (unsigned)_mm_movemask_epi8(m);
+}
+
+template<Cls C>
+__attribute__((target("sse2"))) size_t run_sse2(const char* p, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        unsigned stop = ~sse2_mask<C>(_mm_loadu_si128((const __m128i*)(p + i))) & 0xFFFF;
+        if (stop) return i + __builtin_ctz(stop);
+    }
+    return i + run_scalar<C>(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2_between(__m256i v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8((char)(lo - 1))), _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(hi + 1)), v));
+}
+
+template<Cls C>
+__attribute__((target("avx2"))) unsigned avx2_mask(__m256i v) {
+    __m256i m;
+    switch (C) {
+        case Cls::Space:
+            m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), avx2_between(v, '\t', '\r'));
+            break;
+        case Cls::Ident:
+            m = _mm256_or_si256(avx2_between(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z'),
+                                _mm256_or_si256(avx2_between(v, '0', '9'), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))));
+            break;
+        case Cls::Digit:
+            m = avx2_between(v, '0', '9');
+            break;
+        case Cls::NotQuote:
+            return ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+    }
+    return (unsigned)_mm256_movemask_epi8(m);
+}
+
+template<Cls C>
+__attribute__((target("avx2"))) size_t run_avx2(const char* p, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        unsigned stop = ~avx2_mask<C>(_mm256_loadu_si256((const __m256i*)(p + i)));
+        if (stop) return i + __builtin_ctz(stop);
+    }
+    return i + run_sse2<C>(p + i, n - i);
+}
+#endif
+
+using RunFn = size_t (*)(const char*, size_t);
+
+struct Scanner {
+    RunFn space;
+    RunFn ident;
+    RunFn digit;
+    RunFn string_body;
+};
+
+inline Scanner select_scanner() {
+#if BL_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return Scanner{run_avx2<Cls::Space>, run_avx2<Cls::Ident>, run_avx2<Cls::Digit>, run_avx2<Cls::NotQuote>};
+    if (__builtin_cpu_supports("sse2"))
+        return Scanner{run_sse2<Cls::Space>, run_sse2<Cls::Ident>, run_sse2<Cls::Digit>, run_sse2<Cls::NotQuote>};
+#endif
+    return Scanner{run_scalar<Cls::Space>, run_scalar<Cls::Ident>, run_scalar<Cls::Digit>, run_scalar<Cls::NotQuote>};
+}
+
+// Picked once per process from the running CPU's features.
+inline const Scanner& best() {
+    static const Scanner s = select_scanner();
+    return s;
+}
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+using namespace std;
+
+// Maps each distinct name to a dense id in order of first appearance.
+// Names live in a deque so the string_view keys never dangle.
+class Interner {
+public:
+    int intern(string_view s) {
+        auto it = ids.find(s);
+        if (it != ids.end()) return it->second;
+        int id = (int)names.size();
+        names.emplace_back(s);
+        ids.emplace(names.back(), id);
+        return id;
+    }
+    const string& name(int id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+private:
+    deque<string> names;
+    unordered_map<string_view,int> ids;
+};
+
+// Identifiers and string literals are numbered separately so that an id
+// doubles as the var<N> / str<N> label index in the generated assembly.
+struct Symbols {
+    Interner idents;
+    Interner strings;
+};
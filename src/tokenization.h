@@ -1,9 +1,11 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
-#include <cctype>
 #include <stdexcept>
+#include "scan.h"
+#include "symbols.h"
 using namespace std;
 
 enum class TokenType {
@@ -19,30 +21,27 @@ enum class TokenType {
 struct Token {
     TokenType type;
     optional<string> lexeme;
+    int sym = -1;
 };
 
 class Tokenizer {
 public:
-    inline explicit Tokenizer(string s) : src(move(s)) {}
+    inline Tokenizer(string s, Symbols& syms) : src(move(s)), syms(syms) {}
     vector<Token> tokenize() {
         vector<Token> out;
         while (!is_at_end()) {
             skip_ws();
             if (is_at_end()) break;
             char c = peek();
-            if (isdigit(c)) { out.push_back(Token{TokenType::Int, read_number()}); continue; }
-            if (isalpha(c) || c == '_') {
-                string id = read_ident();
-                if (id == "is") out.push_back(Token{TokenType::Is, {}});
-                else if (id == "else") out.push_back(Token{TokenType::Else, {}});
-                else if (id == "doit") out.push_back(Token{TokenType::DoIt, {}});
-                else if (id == "yeet") out.push_back(Token{TokenType::Yeet, {}});
-                else if (id == "imagine") out.push_back(Token{TokenType::Imagine, {}});
-                else if (id == "print") out.push_back(Token{TokenType::Print, {}});
-                else out.push_back(Token{TokenType::Identifier, id});
+            if (scan::in_class(scan::Cls::Digit, c)) { out.push_back(Token{TokenType::Int, read_number()}); continue; }
+            if (scan::in_class(scan::Cls::Ident, c)) {
+                string_view id = read_ident();
+                TokenType kw = keyword(id);
+                if (kw != TokenType::Identifier) out.push_back(Token{kw, {}});
+                else out.push_back(Token{TokenType::Identifier, {}, syms.idents.intern(id)});
                 continue;
             }
-            if (c == '"') { out.push_back(Token{TokenType::String, read_string()}); continue; }
+            if (c == '"') { out.push_back(Token{TokenType::String, {}, syms.strings.intern(read_string())}); continue; }
             if (c == '+') { advance(); out.push_back(Token{TokenType::Plus, {}}); continue; }
             if (c == '-') { advance(); out.push_back(Token{TokenType::Minus, {}}); continue; }
             if (c == '*') { advance(); out.push_back(Token{TokenType::Star, {}}); continue; }
@@ -64,14 +63,39 @@ public:
     }
 private:
     string src;
+    Symbols& syms;
+    const scan::Scanner& sc = scan::best();
     size_t i = 0;
     bool is_at_end() const { return i >= src.size(); }
     char peek() const { return src[i]; }
     char advance() { return src[i++]; }
     bool match(char ch) { if (!is_at_end() && src[i] == ch) { i++; return true; } return false; }
-    void skip_ws() { while (!is_at_end() && isspace((unsigned char)src[i])) i++; }
+    size_t left() const { return src.size() - i; }
+    void skip_ws() { if (!is_at_end() && scan::in_class(scan::Cls::Space, src[i])) i += sc.space(src.data() + i, left()); }
     [[noreturn]] void fail() { throw runtime_error("lex error"); }
-    string read_number() { size_t s = i; while (!is_at_end() && isdigit((unsigned char)src[i])) i++; return src.substr(s, i - s); }
-    string read_ident() { size_t s = i; while (!is_at_end() && (isalnum((unsigned char)src[i]) || src[i] == '_')) i++; return src.substr(s, i - s); }
-    string read_string() { advance(); size_t s = i; while (!is_at_end() && peek() != '"') i++; string v = src.substr(s, i - s); if (is_at_end()) fail(); advance(); return v; }
+    string read_number() { size_t s = i; i += sc.digit(src.data() + i, left()); return src.substr(s, i - s); }
+    string_view read_ident() { size_t s = i; i += sc.ident(src.data() + i, left()); return string_view(src).substr(s, i - s); }
+    string_view read_string() { advance(); size_t s = i; i += sc.string_body(src.data() + i, left()); string_view v = string_view(src).substr(s, i - s); if (is_at_end()) fail(); advance(); return v; }
+    // Keywords are told apart by length, then first byte, before any compare.
+    static TokenType keyword(string_view id) {
+        switch (id.size()) {
+            case 2:
+                if (id == "is") return TokenType::Is;
+                break;
+            case 4:
+                switch (id[0]) {
+                    case 'e': if (id == "else") return TokenType::Else; break;
+                    case 'd': if (id == "doit") return TokenType::DoIt; break;
+                    case 'y': if (id == "yeet") return TokenType::Yeet; break;
+                }
+                break;
+            case 5:
+                if (id == "print") return TokenType::Print;
+                break;
+            case 7:
+                if (id == "imagine") return TokenType::Imagine;
+                break;
+        }
+        return TokenType::Identifier;
+    }
 };